@@ -0,0 +1,379 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "safe_sqlplus.h"
+
+// Checkpoint/resume for long scripts fed through stdin.
+//
+// On the way in, the input is split into statements and after each one we
+// inject "prompt #safe_sqlplus-checkpoint# <statements> <offset>", where
+// offset is the stdin byte offset just past the statement.  sqlplus prints
+// that line once it has finished running everything before it, so when we
+// see it come back on sqlplus stdout we know that much of the input is
+// done.  The line is stripped from the output.
+//
+// A statement that has run is not safe to skip until it has been committed:
+// if the run dies, Oracle rolls back to the last commit.  So acks are held
+// in memory and only written to the state file when the statement acked
+// ends a transaction (marked "commit" in the prompt), or when sqlplus exits
+// normally and so commits.  --resume seeks stdin to the saved offset, after
+// running again the statements before it that set up the session.
+
+// statements that commit (or roll back) everything before them
+static char *transaction_ends[]={
+    "ALTER", "ANALYZE", "AUDIT", "COMMENT", "COMMIT", "CONN", "CONNECT", "CREATE",
+    "DISC", "DISCONNECT", "DROP", "FLASHBACK", "GRANT", "NOAUDIT", "PURGE", "RENAME",
+    "REVOKE", "ROLLBACK", "TRUNCATE", NULL
+};
+
+// input side
+static unsigned long long in_offset;        // bytes of stdin consumed so far
+static unsigned long long in_statements;    // statements seen so far
+static struct stmt_splitter splitter;
+static char line[STMT_LINE_MAX];            // start of the current input line
+static size_t line_len;
+static char last_nonspace;                  // last non blank char of the current line
+static char head[STMT_LINE_MAX];            // start of the first line of the current statement
+static bool exit_commits=true;              // sqlplus commits when it exits
+static char *inject_buf;
+static size_t inject_len, inject_cap;
+
+// output side
+static const char *tag=CHECKPOINT_TAG;
+static size_t tag_matched;                  // chars of tag seen at the end of the last chunk
+static bool in_tag;                         // between a tag and the end of its line
+static char ack[64];
+static size_t ack_len;
+static bool frozen;
+static bool held;                           // an ack not yet saved
+static unsigned long long held_statements, held_offset;
+
+static char *session_buf;                   // session setup to run again on resume
+static size_t session_len, session_cap;
+
+static int state_fd=-1;
+static unsigned int unsynced;
+
+static void save_state(unsigned long long statements, unsigned long long offset) {
+    char state[CHECKPOINT_STATE_LEN+1];
+    snprintf(state, sizeof(state), "%20llu %20llu\n", statements, offset);
+    if(pwrite(state_fd, state, CHECKPOINT_STATE_LEN, 0) != CHECKPOINT_STATE_LEN) {
+        print_stacktrace();
+        PERROR("pwrite()");
+        exit(1);
+    }
+    // page cache survives us dying, only a crash of the box loses unsynced acks
+    if(++unsynced >= CHECKPOINT_SYNC_EVERY) {
+        fdatasync(state_fd);
+        unsynced=0;
+    }
+}
+
+// Open (and with resume, read) the checkpoint state file.
+// Return: stdin offset to start feeding sqlplus from
+off_t checkpoint_open(char *path, bool resume) {
+    char state[CHECKPOINT_STATE_LEN+1];
+    ssize_t count;
+
+    if((state_fd=open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1) {
+        char logbuf[LOGBUF_MAX];
+        snprintf(logbuf, sizeof(logbuf), "Unable to open checkpoint file \"%s\"", path);
+        PERROR(logbuf);
+        exit(1);
+    }
+    in_offset=0;
+    in_statements=0;
+    if(resume) {
+        memset(state, 0, sizeof(state));
+        if((count=pread(state_fd, state, CHECKPOINT_STATE_LEN, 0)) == -1) {
+            print_stacktrace();
+            PERROR("pread()");
+            exit(1);
+        }
+        if(count > 0 && sscanf(state, "%llu %llu", &in_statements, &in_offset) != 2) {
+            fprintf(stderr, "Checkpoint file \"%s\" is corrupt\n", path);
+            exit(1);
+        }
+        fprintf(stderr, "Resuming after statement %llu (input offset %llu)\n", in_statements, in_offset);
+    } else {
+        save_state(0, 0);
+    }
+    return (off_t)in_offset;
+}
+
+// sqlplus_ok: sqlplus exited by itself with status 0
+void checkpoint_close(bool sqlplus_ok) {
+    if(state_fd == -1)
+        return;
+    // a clean exit commits whatever ran since the last transaction end
+    if(held && sqlplus_ok && exit_commits && !frozen)
+        save_state(held_statements, held_offset);
+    fdatasync(state_fd);
+    close(state_fd);
+    state_fd=-1;
+}
+
+// once failfast has tripped, markers still in flight belong to statements
+// that ran after (or were) the failure, so they must not move the checkpoint
+void checkpoint_freeze(void) {
+    frozen=true;
+    held=false;
+}
+
+// Return: true if nothing run before the statement starting with h can be
+// rolled back once it has run
+static bool ends_transaction(char *h) {
+    for(char **w=transaction_ends; *w != NULL; w++) {
+        if(word_is(h, *w)) {
+            if(word_is(h, "ALTER"))
+                return !word_is(next_word(h), "SESSION") && !word_is(next_word(h), "SYSTEM");
+            if(word_is(h, "ROLLBACK"))
+                return !word_is(next_word(h), "TO");
+            return true;
+        }
+    }
+    return false;
+}
+
+// watch for EXIT ROLLBACK, WHENEVER ... ROLLBACK and SET EXITCOMMIT, which
+// decide whether sqlplus commits on its way out
+static void check_exit_commit(char *h) {
+    if(word_is(h, "EXIT") || word_is(h, "QUIT") || word_is(h, "WHENEVER")) {
+        for(char *w=next_word(h); *w != '\0'; w=next_word(w)) {
+            if(word_is(w, "ROLLBACK"))
+                exit_commits=false;
+        }
+    } else if(word_is(h, "SET")) {
+        for(char *w=next_word(h); *w != '\0'; w=next_word(w)) {
+            if(word_is(w, "EXITC") || word_is(w, "EXITCOMMIT"))
+                exit_commits=!word_is(next_word(w), "OFF");
+        }
+    }
+}
+
+// Return: true if the statement starting with h changes session state a
+// later statement may depend on
+static bool sets_session(char *h) {
+    if(word_is(h, "SET"))
+        return !word_is(next_word(h), "TRANSACTION");
+    if(word_is(h, "ALTER"))
+        return word_is(next_word(h), "SESSION");
+    return word_is(h, "WHENEVER") || word_is(h, "DEF") || word_is(h, "DEFINE") ||
+           word_is(h, "UNDEF") || word_is(h, "UNDEFINE");
+}
+
+// Go through the part of stdin the last run got through and pick out the
+// statements that set up the session (SET, ALTER SESSION, WHENEVER, DEFINE),
+// so sqlplus can run them again before picking up where it left off.  stdin
+// has already been checked to be seekable.
+// Return: the statements, their length in *outlen
+char *checkpoint_session(size_t *outlen) {
+    struct stmt_splitter sp={STMT_NONE};
+    char buf[BUF_MAX];
+    char *cur=NULL;         // the current line, all of it
+    size_t cur_len=0, cur_cap=0;
+    off_t pos=0;
+    ssize_t count=0;
+    bool keep=false, connected=false;
+
+    while(pos < (off_t)in_offset && (count=pread(fileno(stdin), buf, sizeof(buf), pos)) > 0) {
+        const char *p=buf, *end=buf+count;
+        if(pos+count > (off_t)in_offset)
+            end=buf+(in_offset-pos);
+        pos+=count;
+        while(p < end) {
+            const char *nl=memchr(p, '\n', end-p);
+            const char *stop=nl != NULL ? nl+1 : end;
+            char l[STMT_LINE_MAX], last='\0', *h;
+            bool starting, ended;
+            append(&cur, &cur_len, &cur_cap, p, stop-p);
+            p=stop;
+            if(nl == NULL)
+                break;
+            for(size_t i=cur_len; i > 0; i--) {
+                if(!isspace((unsigned char)cur[i-1])) {
+                    last=cur[i-1];
+                    break;
+                }
+            }
+            snprintf(l, sizeof(l), "%.*s", (int)(cur_len-1), cur);
+            starting=sp.kind == STMT_NONE;
+            ended=stmt_end_of_line(&sp, l, last);
+            if(starting && (ended || sp.kind != STMT_NONE)) {
+                for(h=l; isspace((unsigned char)*h); h++)
+                    ;
+                keep=sets_session(h);
+                connected|=word_is(h, "CONN") || word_is(h, "CONNECT");
+            }
+            if(keep && (!starting || ended || sp.kind != STMT_NONE))
+                append(&session_buf, &session_len, &session_cap, cur, cur_len);
+            cur_len=0;
+        }
+    }
+    if(count == -1) {
+        print_stacktrace();
+        PERROR("pread()");
+        exit(1);
+    }
+    free(cur);
+    if(connected)
+        fprintf(stderr, "Warning: the script connected as another user before the checkpoint, resuming as the login user\n");
+    if(session_len > 0)
+        fprintf(stderr, "Running again the session setup from before the checkpoint\n");
+    *outlen=session_len;
+    return session_buf;
+}
+
+// Pass a chunk of stdin through the statement splitter.  The input comes back
+// unchanged apart from a checkpoint prompt after each statement.
+// Return: pointer to the text to send to sqlplus, its length in *outlen
+char *checkpoint_track(const char *buf, size_t len, size_t *outlen) {
+    const char *p=buf, *end=buf+len, *copied=buf;
+    bool starting, ended;
+
+    inject_len=0;
+
+    while(p < end) {
+        const char *nl=memchr(p, '\n', end-p);
+        const char *stop=nl != NULL ? nl : end;
+        // only the start and the last non blank char of a line matter
+        size_t room=sizeof(line)-1-line_len;
+        size_t n=(size_t)(stop-p) < room ? (size_t)(stop-p) : room;
+        memcpy(line+line_len, p, n);
+        line_len+=n;
+        for(const char *c=stop; c > p; c--) {
+            if(!isspace((unsigned char)c[-1])) {
+                last_nonspace=c[-1];
+                break;
+            }
+        }
+        if(nl == NULL)
+            break;
+        p=nl+1;
+        line[line_len]='\0';
+        starting=splitter.kind == STMT_NONE;
+        ended=stmt_end_of_line(&splitter, line, last_nonspace);
+        if(starting && (ended || splitter.kind != STMT_NONE)) {
+            char *l=line;
+            while(isspace((unsigned char)*l))
+                l++;
+            strcpy(head, l);
+        }
+        if(ended) {
+            char marker[128];
+            int marker_len;
+            in_statements++;
+            check_exit_commit(head);
+            marker_len=snprintf(marker, sizeof(marker), "prompt %s %llu %llu%s\n", tag, in_statements,
+                                in_offset+(p-buf), ends_transaction(head) ? " commit" : "");
+            append(&inject_buf, &inject_len, &inject_cap, copied, p-copied);
+            append(&inject_buf, &inject_len, &inject_cap, marker, marker_len);
+            copied=p;
+        }
+        line_len=0;
+        last_nonspace='\0';
+    }
+    append(&inject_buf, &inject_len, &inject_cap, copied, end-copied);
+    in_offset+=len;
+    *outlen=inject_len;
+    return inject_buf;
+}
+
+static void acknowledge(void) {
+    unsigned long long statements, offset;
+    char commit[8];
+    int fields;
+
+    ack[ack_len]='\0';
+    if(frozen || (fields=sscanf(ack, "%llu %llu %7s", &statements, &offset, commit)) < 2)
+        return;
+    held=true;
+    held_statements=statements;
+    held_offset=offset;
+    if(fields == 3) {
+        save_state(statements, offset);
+        held=false;
+    }
+}
+
+// Strip checkpoint prompts out of a chunk of sqlplus stdout, recording each
+// one as acknowledged.  A tag split across chunks is held back until the next
+// call.  out must have room for len+strlen(CHECKPOINT_TAG) bytes.
+// Return: number of bytes written to out
+size_t checkpoint_filter(const char *buf, size_t len, char *out) {
+    const char *p=buf, *end=buf+len;
+    size_t tag_len=strlen(tag);
+    char *o=out;
+
+    while(p < end) {
+        if(in_tag) {
+            if(*p == '\n') {
+                acknowledge();
+                in_tag=false;
+                ack_len=0;
+            } else if(ack_len < sizeof(ack)-1) {
+                ack[ack_len++]=*p;
+            }
+            p++;
+            continue;
+        }
+        if(tag_matched == 0) {
+            // nothing pending, copy up to the next possible start of a tag
+            const char *hash=memchr(p, tag[0], end-p);
+            const char *stop=hash != NULL ? hash : end;
+            memcpy(o, p, stop-p);
+            o+=stop-p;
+            p=stop;
+            if(hash == NULL)
+                break;
+        }
+        if(*p == tag[tag_matched]) {
+            p++;
+            if(++tag_matched == tag_len) {
+                in_tag=true;
+                tag_matched=0;
+            }
+        } else {
+            // false start, give back what we held.  tag[0] occurs nowhere else
+            // in a partial tag, so the mismatched char can only restart a match
+            memcpy(o, tag, tag_matched);
+            o+=tag_matched;
+            tag_matched=0;
+        }
+    }
+    return o-out;
+}
@@ -0,0 +1,318 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "safe_sqlplus.h"
+
+// Rewrites runs of single row inserts on stdin
+//
+//     INSERT INTO t (a, b) VALUES (1, 'x');
+//     INSERT INTO t (a, b) VALUES (2, 'y');
+//
+// into one multitable insert, so sqlplus makes one round trip per batch
+//
+//     INSERT ALL
+//     INTO t (a, b) VALUES (1, 'x')
+//     INTO t (a, b) VALUES (2, 'y')
+//     SELECT 1 FROM DUAL;
+//
+// Only an insert that is a whole line by itself, at the top level of the
+// script, is considered.  VALUES lists using a sequence (NEXTVAL is only
+// evaluated once per INSERT ALL) or a subquery are left alone, as is anything
+// else the parser doesn't recognize.
+
+struct insert {
+    char *key;        // "t (a, b)", the table and column list
+    size_t key_len;
+    char *values;     // "(1, 'x')"
+    size_t values_len;
+    int num_values;
+};
+
+static struct stmt_splitter splitter;
+static char *line;
+static size_t line_len, line_cap;
+static char *batch;               // "INTO ... VALUES (...)\n" for each row
+static size_t batch_len, batch_cap;
+static char *batch_key;
+static size_t batch_key_len, batch_key_cap;
+static int batch_rows;
+static unsigned long rows_since_commit;
+static char *out;
+static size_t out_len, out_cap;
+
+static void emit(const char *s, size_t n) {
+    append(&out, &out_len, &out_cap, s, n);
+}
+
+static bool is_ident(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '$' || c == '#';
+}
+
+static char *skip_space(char *p, char *end) {
+    while(p < end && isspace((unsigned char)*p))
+        p++;
+    return p;
+}
+
+static bool keyword(char *p, char *end, char *word) {
+    size_t len=strlen(word);
+    return (size_t)(end-p) >= len && strncasecmp(p, word, len) == 0 && (p+len == end || !is_ident(p[len]));
+}
+
+// Return: pointer just past a "quoted identifier" or 'string literal' starting at p,
+//         or NULL if it isn't closed on this line
+static char *skip_quoted(char *p, char *end) {
+    char quote=*p++;
+    while(p < end) {
+        if(*p++ == quote) {
+            if(quote == '\'' && p < end && *p == '\'')
+                p++;  // '' inside a string
+            else
+                return p;
+        }
+    }
+    return NULL;
+}
+
+static bool parse_insert(char *p, char *end, struct insert *ins) {
+    int depth;
+
+    p=skip_space(p, end);
+    if(!keyword(p, end, "INSERT"))
+        return false;
+    p=skip_space(p+6, end);
+    if(!keyword(p, end, "INTO"))
+        return false;
+    p=skip_space(p+4, end);
+
+    // [schema.]table, either part possibly quoted
+    ins->key=p;
+    while(p < end && (is_ident(*p) || *p == '.' || *p == '"')) {
+        if(*p == '"') {
+            if((p=skip_quoted(p, end)) == NULL)
+                return false;
+        } else {
+            p++;
+        }
+    }
+    if(p == ins->key)
+        return false;
+    ins->key_len=p-ins->key;
+    p=skip_space(p, end);
+    if(p < end && *p == '(') {
+        // column list
+        while(p < end && *p != ')') {
+            if(*p == '"') {
+                if((p=skip_quoted(p, end)) == NULL)
+                    return false;
+            } else {
+                p++;
+            }
+        }
+        if(p == end)
+            return false;
+        p++;
+        ins->key_len=p-ins->key;
+        p=skip_space(p, end);
+    }
+    if(!keyword(p, end, "VALUES"))
+        return false;
+    p=skip_space(p+6, end);
+    if(p == end || *p != '(')
+        return false;
+
+    ins->values=p;
+    ins->num_values=1;
+    depth=0;
+    while(p < end) {
+        if(*p == '\'' || *p == '"') {
+            if((p=skip_quoted(p, end)) == NULL)
+                return false;
+            continue;
+        }
+        if(is_ident(*p)) {
+            char *word=p;
+            // q'[...]' literals can hold anything, don't try to parse them
+            if((*p == 'q' || *p == 'Q') && p+1 < end && p[1] == '\'')
+                return false;
+            if((*p == 'n' || *p == 'N') && p+2 < end && (p[1] == 'q' || p[1] == 'Q') && p[2] == '\'')
+                return false;
+            while(p < end && is_ident(*p))
+                p++;
+            if(keyword(word, p, "NEXTVAL") || keyword(word, p, "CURRVAL") || keyword(word, p, "SELECT"))
+                return false;
+            continue;
+        }
+        if(*p == '(') {
+            depth++;
+        } else if(*p == ')') {
+            if(--depth == 0) {
+                p++;
+                break;
+            }
+        } else if(*p == ',' && depth == 1) {
+            ins->num_values++;
+        }
+        p++;
+    }
+    if(depth != 0)
+        return false;
+    ins->values_len=p-ins->values;
+    p=skip_space(p, end);
+    if(p == end || *p != ';')
+        return false;
+    return skip_space(p+1, end) == end;
+}
+
+static void flush_batch(void) {
+    char commit[]="COMMIT;\n";
+
+    if(batch_rows == 0)
+        return;
+    if(batch_rows == 1) {
+        // not worth an INSERT ALL, put it back the way it was
+        emit("INSERT ", 7);
+        emit(batch, batch_len-1);
+        emit(";\n", 2);
+    } else {
+        emit("INSERT ALL\n", 11);
+        emit(batch, batch_len);
+        emit("SELECT 1 FROM DUAL;\n", 20);
+    }
+    rows_since_commit+=batch_rows;
+    if(commit_every > 0 && rows_since_commit >= (unsigned long)commit_every) {
+        emit(commit, strlen(commit));
+        rows_since_commit=0;
+    }
+    batch_len=0;
+    batch_rows=0;
+}
+
+static void add_row(struct insert *ins) {
+    if(batch_rows > 0 &&
+       (batch_key_len != ins->key_len || memcmp(batch_key, ins->key, ins->key_len) != 0 ||
+        (batch_rows+1)*ins->num_values > COALESCE_MAX_VALUES))
+        flush_batch();
+    if(batch_rows == 0) {
+        batch_key_len=0;
+        append(&batch_key, &batch_key_len, &batch_key_cap, ins->key, ins->key_len);
+    }
+    append(&batch, &batch_len, &batch_cap, "INTO ", 5);
+    append(&batch, &batch_len, &batch_cap, ins->key, ins->key_len);
+    append(&batch, &batch_len, &batch_cap, " VALUES ", 8);
+    append(&batch, &batch_len, &batch_cap, ins->values, ins->values_len);
+    append(&batch, &batch_len, &batch_cap, "\n", 1);
+    if(++batch_rows >= coalesce_rows)
+        flush_batch();
+}
+
+// handle one line of input, without its newline
+static void do_line(char *l, size_t len, bool newline) {
+    struct insert ins;
+    char head[STMT_LINE_MAX];
+    char last_nonspace='\0';
+    bool top_level=splitter.kind == STMT_NONE;
+    size_t head_len=len < sizeof(head)-1 ? len : sizeof(head)-1;
+
+    memcpy(head, l, head_len);
+    head[head_len]='\0';
+    for(size_t i=len; i > 0; i--) {
+        if(!isspace((unsigned char)l[i-1])) {
+            last_nonspace=l[i-1];
+            break;
+        }
+    }
+    stmt_end_of_line(&splitter, head, last_nonspace);
+    if(top_level && parse_insert(l, l+len, &ins)) {
+        add_row(&ins);
+        return;
+    }
+    flush_batch();
+    emit(l, len);
+    if(newline)
+        emit("\n", 1);
+}
+
+// Run a chunk of stdin through the rewriter.  Rows may be held back until a
+// batch fills up or something other than an insert comes along.
+// Return: text to send to sqlplus, its length in *outlen
+char *coalesce_feed(const char *buf, size_t len, size_t *outlen) {
+    const char *p=buf, *end=buf+len;
+
+    out_len=0;
+    while(p < end) {
+        const char *nl=memchr(p, '\n', end-p);
+        if(nl == NULL) {
+            append(&line, &line_len, &line_cap, p, end-p);
+            break;
+        }
+        if(line_len == 0) {
+            // whole line is in buf, skip the copy
+            do_line((char *)p, nl-p, true);
+        } else {
+            append(&line, &line_len, &line_cap, p, nl-p);
+            do_line(line, line_len, true);
+            line_len=0;
+        }
+        p=nl+1;
+    }
+    *outlen=out_len;
+    return out;
+}
+
+// stdin has gone quiet, send sqlplus what we're holding rather than wait
+char *coalesce_flush(size_t *outlen) {
+    out_len=0;
+    flush_batch();
+    *outlen=out_len;
+    return out;
+}
+
+// end of stdin
+char *coalesce_finish(size_t *outlen) {
+    out_len=0;
+    if(line_len > 0) {
+        do_line(line, line_len, false);
+        line_len=0;
+    }
+    flush_batch();
+    *outlen=out_len;
+    return out;
+}
+
+bool coalesce_holding(void) {
+    return batch_rows > 0;
+}
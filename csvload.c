@@ -0,0 +1,404 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#define _GNU_SOURCE   // memrchr()
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "safe_sqlplus.h"
+
+// --loadcsv: turn a CSV file into batched INSERT ALL statements and feed them
+// to sqlplus in place of stdin.
+//
+// The file is mmap(2)ed and parsed in place (RFC 4180: ',' between fields,
+// "..." quoting with "" for a quote).  The first record names the columns.
+// Values go to Oracle as string literals and are converted to the column
+// type with the session's NLS settings; empty values are NULL.  Embedded
+// newlines become CHR(10)/CHR(13) and long values are split with || so no
+// line sent to sqlplus gets near its input line limit.
+
+struct field {
+    const char *p;
+    size_t len;
+    bool quoted;
+};
+
+static char *csv_path;
+static const char *csv, *csv_end, *pos;
+static size_t csv_size;
+static unsigned long long record;            // 1 is the header
+static char *insert_into;                    // "INTO table (col, ...) VALUES ("
+static struct field *fields;
+static int num_cols;
+static int batch_rows;
+static int commit_rows;
+static unsigned long long rows_sent, rows_since_commit;
+static struct timespec started, last_report;
+static bool started_sql, done, failed;
+static char *out;
+static size_t out_len, out_cap;
+static size_t line_start;                    // offset in out of the current line
+
+static void emit(const char *s, size_t n) {
+    const char *nl;
+
+    append(&out, &out_len, &out_cap, s, n);
+    if((nl=memrchr(s, '\n', n)) != NULL)
+        line_start=out_len-(n-(nl-s+1));
+}
+
+static void emits(const char *s) {
+    emit(s, strlen(s));
+}
+
+// start a new line if the current one can't take n more bytes
+static void make_room(size_t n) {
+    if(out_len > line_start && out_len-line_start+n > CSV_LINE_MAX)
+        emit("\n", 1);
+}
+
+// same, inside a string literal
+static void make_literal_room(size_t n) {
+    if(out_len-line_start+n > CSV_LINE_MAX) {
+        emits("'||\n");
+        emits("'");
+    }
+}
+
+// Return: first of a, b, c or d at or after p, or end
+static const char *find_any(const char *p, const char *end, char a, char b, char c, char d) {
+#ifdef __SSE2__
+    __m128i va=_mm_set1_epi8(a), vb=_mm_set1_epi8(b), vc=_mm_set1_epi8(c), vd=_mm_set1_epi8(d);
+    while(end-p >= 16) {
+        __m128i v=_mm_loadu_si128((const __m128i *)p);
+        int mask=_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                                _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd))));
+        if(mask != 0)
+            return p+__builtin_ctz(mask);
+        p+=16;
+    }
+#endif
+    for(; p < end; p++) {
+        if(*p == a || *p == b || *p == c || *p == d)
+            return p;
+    }
+    return end;
+}
+
+// Split the next record into fields.
+// Return: number of fields, 0 at end of file, -1 if the record is malformed
+static int next_record(struct field *f, int max) {
+    int n=0;
+
+    // blank lines don't count as records
+    while(pos < csv_end && (*pos == '\n' || *pos == '\r'))
+        pos++;
+    if(pos == csv_end)
+        return 0;
+    record++;
+    while(1) {
+        if(n == max)
+            return -1;
+        if(*pos == '"') {
+            const char *q=pos+1, *close;
+            while(1) {
+                if((close=memchr(q, '"', csv_end-q)) == NULL)
+                    return -1;   // unterminated quote
+                if(close+1 < csv_end && close[1] == '"') {
+                    q=close+2;
+                    continue;
+                }
+                break;
+            }
+            f[n].p=pos+1;
+            f[n].len=close-(pos+1);
+            f[n].quoted=true;
+            pos=close+1;
+        } else {
+            const char *stop=find_any(pos, csv_end, ',', '\n', '\r', ',');
+            f[n].p=pos;
+            f[n].len=stop-pos;
+            f[n].quoted=false;
+            pos=stop;
+        }
+        n++;
+        if(pos == csv_end)
+            return n;
+        if(*pos == ',') {
+            pos++;
+            if(pos == csv_end) {
+                if(n == max)
+                    return -1;
+                f[n].p=pos;   // trailing empty field
+                f[n].len=0;
+                f[n].quoted=false;
+                return n+1;
+            }
+            continue;
+        }
+        if(*pos == '\r')
+            pos++;
+        if(pos < csv_end && *pos == '\n')
+            pos++;
+        else if(pos < csv_end)
+            return -1;   // junk after a closing quote
+        return n;
+    }
+}
+
+// Emit a field as an Oracle literal, split so no line runs past CSV_LINE_MAX
+static void emit_literal(struct field *f) {
+    const char *p=f->p, *end=f->p+f->len;
+
+    if(f->len == 0) {
+        emits("NULL");
+        return;
+    }
+    emit("'", 1);
+    while(p < end) {
+        const char *special=find_any(p, end, '\'', '\n', '\r', f->quoted ? '"' : '\'');
+        size_t room;
+        while(p < special) {
+            size_t n=special-p;
+            make_literal_room(1);
+            room=CSV_LINE_MAX-(out_len-line_start);
+            if(n > room) {
+                n=room;
+                // don't split a UTF-8 sequence
+                while(n > 0 && (p[n] & 0xc0) == 0x80)
+                    n--;
+                if(n == 0)
+                    n=special-p < 4 ? (size_t)(special-p) : 4;
+            }
+            emit(p, n);
+            p+=n;
+        }
+        if(p == end)
+            break;
+        switch(*p) {
+            case '\'':
+                make_literal_room(2);
+                emit("''", 2);
+                break;
+            case '\n':
+                make_literal_room(13);
+                emits("'||CHR(10)||'");
+                break;
+            case '\r':
+                make_literal_room(13);
+                emits("'||CHR(13)||'");
+                break;
+            case '"':
+                // "" inside a quoted field is one quote
+                make_literal_room(1);
+                emit("\"", 1);
+                p++;
+                break;
+        }
+        p++;
+    }
+    emit("'", 1);
+}
+
+static bool simple_identifier(const char *p, size_t len) {
+    for(size_t i=0; i < len; i++) {
+        char c=p[i];
+        if(!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+             c == '_' || c == '$' || c == '#'))
+            return false;
+    }
+    return len > 0;
+}
+
+static double since(struct timespec *t, struct timespec *now) {
+    return (now->tv_sec-t->tv_sec)+(now->tv_nsec-t->tv_nsec)/1e9;
+}
+
+static void report(bool final) {
+    struct timespec now;
+    double elapsed;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(!final && since(&last_report, &now) < 1.0)
+        return;
+    last_report=now;
+    elapsed=since(&started, &now);
+    fprintf(stderr, "%s: %llu rows %s (%.0f rows/s)\n", csv_path, rows_sent, final ? "sent" : "sent so far",
+            elapsed > 0 ? rows_sent/elapsed : 0.0);
+    fflush(stderr);
+}
+
+void csvload_open(char *table, char *path) {
+    struct stat st;
+    int fd, n;
+    char logbuf[LOGBUF_MAX];
+    size_t len;
+
+    csv_path=path;
+    if((fd=open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        snprintf(logbuf, sizeof(logbuf), "Unable to open CSV file \"%s\"", path);
+        PERROR(logbuf);
+        exit(1);
+    }
+    csv_size=st.st_size;
+    if(csv_size == 0) {
+        fprintf(stderr, "CSV file \"%s\" is empty, it needs at least a header line\n", path);
+        exit(1);
+    }
+    if((csv=mmap(NULL, csv_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        snprintf(logbuf, sizeof(logbuf), "Unable to mmap CSV file \"%s\"", path);
+        PERROR(logbuf);
+        exit(1);
+    }
+    close(fd);
+    madvise((void *)csv, csv_size, MADV_SEQUENTIAL);
+    csv_end=csv+csv_size;
+    pos=csv;
+
+    // header line gives the column list
+    if((fields=malloc(CSV_COLUMNS_MAX * sizeof(*fields))) == NULL) {
+        print_stacktrace();
+        PERROR("malloc()");
+        exit(1);
+    }
+    if((n=next_record(fields, CSV_COLUMNS_MAX)) <= 0) {
+        fprintf(stderr, "Could not read the header line of CSV file \"%s\"\n", path);
+        exit(1);
+    }
+    num_cols=n;
+    emits("INTO ");
+    emits(table);
+    emits(" (");
+    for(int i=0; i < num_cols; i++) {
+        if(i > 0)
+            emits(", ");
+        make_room(fields[i].len+3);
+        if(simple_identifier(fields[i].p, fields[i].len)) {
+            emit(fields[i].p, fields[i].len);
+        } else {
+            emit("\"", 1);
+            emit(fields[i].p, fields[i].len);
+            emit("\"", 1);
+        }
+    }
+    make_room(10);
+    emits(") VALUES (");
+    len=out_len;
+    if((insert_into=malloc(len+1)) == NULL) {
+        print_stacktrace();
+        PERROR("malloc()");
+        exit(1);
+    }
+    memcpy(insert_into, out, len);
+    insert_into[len]='\0';
+    out_len=0;
+    line_start=0;
+
+    batch_rows=coalesce_rows > 0 ? coalesce_rows : CSV_BATCH_ROWS;
+    if(batch_rows*num_cols > COALESCE_MAX_VALUES)
+        batch_rows=COALESCE_MAX_VALUES/num_cols > 0 ? COALESCE_MAX_VALUES/num_cols : 1;
+    commit_rows=commit_every > 0 ? commit_every : CSV_COMMIT_EVERY;
+    if(debug)
+        fprintf(stderr, "loadcsv: %d columns, %d rows per insert, commit every %d rows\n", num_cols, batch_rows, commit_rows);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    last_report=started;
+}
+
+// Generate the next batch of SQL for sqlplus.
+// Return: the SQL with its length in *outlen, or NULL once everything has been sent
+char *csvload_next(size_t *outlen) {
+    int rows=0, n;
+
+    if(done)
+        return NULL;
+    out_len=0;
+    line_start=0;
+    if(!started_sql) {
+        // data may contain &, and the connect sequence turned substitution back on.
+        // A batch Oracle rejects has to stop the load, not just print an ORA-
+        emits("set define off\nwhenever sqlerror exit failure rollback\n");
+        started_sql=true;
+    }
+    while(rows < batch_rows && (n=next_record(fields, num_cols)) != 0) {
+        if(n != num_cols) {
+            fprintf(stderr, "%s: record %llu is malformed or has the wrong number of fields (header has %d), stopping\n",
+                    csv_path, record, num_cols);
+            fflush(stderr);
+            out_len=0;
+            emits("rollback;\nexit failure rollback\n");
+            done=true;
+            failed=true;
+            *outlen=out_len;
+            return out;
+        }
+        if(rows == 0)
+            emits("INSERT ALL\n");
+        emits(insert_into);
+        for(int i=0; i < num_cols; i++) {
+            if(i > 0)
+                emits(", ");
+            // every value starts on a line with room for at least its quotes
+            make_room(4);
+            emit_literal(&fields[i]);
+        }
+        emits(")\n");
+        rows++;
+    }
+    if(rows > 0) {
+        emits("SELECT 1 FROM DUAL;\n");
+        rows_sent+=rows;
+        rows_since_commit+=rows;
+    }
+    if(pos == csv_end && rows < batch_rows) {
+        emits("commit;\n");
+        done=true;
+        report(true);
+    } else if(rows_since_commit >= (unsigned long long)commit_rows) {
+        emits("commit;\n");
+        rows_since_commit=0;
+    }
+    if(!done)
+        report(false);
+    *outlen=out_len;
+    return out;
+}
+
+// Return: true if loading stopped on a bad record
+bool csvload_failed(void) {
+    return failed;
+}
@@ -0,0 +1,164 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "safe_sqlplus.h"
+
+// Multi-pattern matcher for sqlplus error prefixes (ORA-, SP2-, ...).
+//
+// The prefixes are compiled into a trie, flattened into a full DFA so that
+// each byte of output costs one table lookup.  Every pattern is anchored to
+// the start of a line by prepending a '\n' to it, which means the root state
+// can only be left on a newline, and a mismatch anywhere else falls straight
+// back to the root (or to the start of a line, on a newline), so no
+// Aho-Corasick failure links are needed.  While in the root state we let
+// memchr(3) skip straight to the next newline, so the common case (ordinary
+// result rows) is scanned at memchr speed.
+//
+// Without -S sqlplus puts its prompt in front of its own messages on the
+// same line ("SQL> SP2-0734: unknown command ..."), so "SQL> " and the
+// "  2  " line number prompt are skipped at the start of a line, as many
+// times as they come, before the prefixes are matched.
+
+static unsigned short (*delta)[256];   // delta[state][byte] -> next state
+static bool *accept;                   // accept[state] is true if a prefix ended here
+static int num_states;
+static int line_start;                 // just after a newline
+
+static int add_state(void) {
+    if((delta=realloc(delta, (num_states+1) * sizeof(*delta))) == NULL ||
+       (accept=realloc(accept, (num_states+1) * sizeof(*accept))) == NULL) {
+        print_stacktrace();
+        PERROR("realloc()");
+        exit(1);
+    }
+    memset(delta[num_states], 0, sizeof(*delta));
+    accept[num_states]=false;
+    return num_states++;
+}
+
+// loop back to the start of the line over sqlplus prompts
+static void add_prompts(void) {
+    int s=line_start, spaces, digits, gap;
+
+    // "SQL> "
+    for(unsigned char *p=(unsigned char *)"SQL>"; *p != '\0'; p++) {
+        int next=add_state();   // moves delta, don't index it before this
+        delta[s][*p]=next;
+        s=next;
+    }
+    delta[s][' ']=line_start;
+    // line number, right aligned in 3 columns, and two blanks
+    spaces=add_state();
+    digits=add_state();
+    gap=add_state();
+    delta[line_start][' ']=spaces;
+    delta[spaces][' ']=spaces;
+    for(int c='0'; c <= '9'; c++) {
+        delta[line_start][c]=digits;
+        delta[spaces][c]=digits;
+        delta[digits][c]=digits;
+    }
+    delta[digits][' ']=gap;
+    delta[gap][' ']=line_start;
+}
+
+// prefixes is a comma separated list, ex: "ORA-,SP2-"
+void errscan_init(char *prefixes) {
+    char copy[ERROR_PREFIXES_MAX];
+    char *prefix, *saveptr;
+
+    num_states=0;
+    add_state();   // state 0 is the root
+    line_start=add_state();
+    delta[0]['\n']=line_start;
+    add_prompts();
+    // build the trie.  0 doubles as "no edge yet" since nothing points back at
+    // the root.  A prefix starting with a blank or digit shares the prompt states
+    strncpy(copy, prefixes, sizeof(copy));
+    copy[sizeof(copy)-1]='\0';
+    for(prefix=strtok_r(copy, ",", &saveptr); prefix != NULL; prefix=strtok_r(NULL, ",", &saveptr)) {
+        int s, next;
+        if(*prefix == '\0')
+            continue;
+        s=line_start;
+        for(unsigned char *p=(unsigned char *)prefix; *p != '\0'; p++) {
+            if((next=delta[s][*p]) == 0) {
+                next=add_state();
+                delta[s][*p]=next;
+            }
+            s=next;
+        }
+        accept[s]=true;
+        if(debug)
+            fprintf(stderr, "errscan: watching for error prefix \"%s\"\n", prefix);
+    }
+
+    // fill in the missing transitions, turning the trie into a DFA.  The
+    // prefixes can't hold a newline, so a newline always starts a new line
+    for(int s=0; s < num_states; s++) {
+        if(delta[s]['\n'] == 0)
+            delta[s]['\n']=line_start;
+    }
+}
+
+// the beginning of a stream counts as the beginning of a line
+void errscan_reset(struct errscan *es) {
+    es->state=line_start;
+}
+
+// Feed the next chunk of a stream through the matcher.  State is carried
+// across calls, so a prefix split over two reads is still found.
+// Return: number of bytes of buf up to and including the end of the first
+//         error prefix seen, or 0 if there wasn't one
+size_t errscan_feed(struct errscan *es, const char *buf, size_t len) {
+    const unsigned char *start=(const unsigned char *)buf;
+    const unsigned char *p=start;
+    const unsigned char *end=p+len;
+    int s=es->state;
+
+    while(p < end) {
+        if(s == 0) {
+            // only a newline can start a match, skip ahead to it
+            if((p=memchr(p, '\n', end-p)) == NULL)
+                break;
+        }
+        s=delta[s][*p++];
+        if(accept[s]) {
+            es->state=0;
+            return p-start;
+        }
+    }
+    es->state=s;
+    return 0;
+}
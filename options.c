@@ -30,17 +30,27 @@
 // Sat May  3 22:46:30 MDT 2014
 //
 #include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "safe_sqlplus.h"
 
 static struct option long_options[]={
+      {"checkpoint"     , required_argument, NULL, 'k'},
+      {"coalesce"       , required_argument, NULL, 'i'},
+      {"commitevery"    , required_argument, NULL, 'C'},
       {"connectstring"  , required_argument, NULL, 'c'},
       {"debug"          , no_argument      , NULL, 'd'},
+      {"errorprefixes"  , required_argument, NULL, 'e'},
+      {"failfast"       , no_argument      , NULL, 'f'},
       {"help"           , no_argument      , NULL, 'h'},
+      {"loadcsv"        , required_argument, NULL, 'L'},
       {"oraclehome"     , required_argument, NULL, 'o'},
       {"passwordprogram", required_argument, NULL, 'p'},
+      {"record"         , required_argument, NULL, 't'},
+      {"resume"         , no_argument      , NULL, 'R'},
+      {"rollback"       , no_argument      , NULL, 'r'},
       {"sqlplusargs"    , required_argument, NULL, 'a'},
       {"usernameprogram", required_argument, NULL, 'u'},
       {NULL             , 0,                 NULL,  0 }
@@ -72,18 +82,58 @@ void usage(char *argv0) {
     printf("Optional:\n");
     printf(" -a,--sqlplusargs       Additional arguments to pass to the sqlplus program\n");
     printf(" -d,--debug             Print debug messages\n");
+    printf(" -f,--failfast          Watch sqlplus output and stop feeding it stdin as soon as a line\n");
+    printf("                        starts with one of the error prefixes.  Exits with %d when this happens\n", FAILFAST_EXIT);
+    printf(" -e,--errorprefixes     Comma separated list of error prefixes for --failfast\n");
+    printf("                        (default \"%s\").  sqlplus prompts (\"SQL> \", \"  2  \") in\n", ERROR_PREFIXES);
+    printf("                        front of them on the same line are skipped\n");
+    printf(" -r,--rollback          With --failfast, send sqlplus a rollback and exit instead of\n");
+    printf("                        just closing its stdin\n");
+    printf(" -k,--checkpoint        File to record progress through stdin in.  After each COMMIT or\n");
+    printf("                        DDL sqlplus finishes, the statement count and input offset are saved\n");
+    printf(" -R,--resume            With --checkpoint, skip stdin ahead to the last statement sqlplus\n");
+    printf("                        committed on the previous run.  stdin must be a regular file\n");
+    printf(" -i,--coalesce          Rewrite runs of single row INSERT INTO t (...) VALUES (...); lines\n");
+    printf("                        on stdin into INSERT ALL statements of up to this many rows\n");
+    printf("                        With --loadcsv, rows per INSERT ALL (default %d)\n", CSV_BATCH_ROWS);
+    printf(" -C,--commitevery       With --coalesce or --loadcsv, COMMIT after about this many rows\n");
+    printf("                        (--loadcsv default %d)\n", CSV_COMMIT_EVERY);
+    printf(" -L,--loadcsv table file\n");
+    printf("                        Load a CSV file into table instead of reading stdin.  The first\n");
+    printf("                        line of the file names the columns\n");
+    printf(" -t,--record            Write a trace of the session (stdin, sqlplus output and timing) to\n");
+    printf("                        this file, for playing back with sqlplus_replay.  Passwords and\n");
+    printf("                        connect commands are redacted\n");
     printf(" -h,--help              This help message\n");
     printf("Report bugs to <ryan@rchapman.org>\n");
 }
 
+// Return: value of a positive integer option, exits on anything else
+static int parse_count(char *arg, char *name) {
+    char *end;
+    long n;
+    n=strtol(arg, &end, 10);
+    if(*arg == '\0' || *end != '\0' || n <= 0 || n > INT_MAX) {
+        fprintf(stderr, "Usage error: --%s must be a positive number, not \"%s\"\n", name, arg);
+        exit(1);
+    }
+    return (int)n;
+}
+
 void parse_args(int argc, char *argv[]) {
     bool show_usage_and_exit=false;
     int c;
     int option_index=0;
     
     debug=false;
+    failfast=false;
+    failfast_rollback=false;
+    resume=false;
+    coalesce_rows=0;
+    commit_every=0;
+    strncpy(error_prefixes, ERROR_PREFIXES, sizeof(error_prefixes));
 
-    while((c=getopt_long(argc, argv, "a:c:dho:p:u:", long_options, &option_index)) != -1) {
+    while((c=getopt_long(argc, argv, "a:c:C:de:fhi:k:L:o:p:rRt:u:", long_options, &option_index)) != -1) {
         switch(c) {
             case 0: // flag. do nothing.
                 break;
@@ -99,13 +149,44 @@ void parse_args(int argc, char *argv[]) {
                 else
                     strncpy(connect_template, optarg, sizeof(connect_template));
                 break;
+            case 'C':
+                commit_every=parse_count(optarg, "commitevery");
+                break;
             case 'd':
                 debug=true;
                 break;
+            case 'e':
+                if(optarg == NULL)
+                    error_prefixes[0]='\0';
+                else
+                    strncpy(error_prefixes, optarg, sizeof(error_prefixes));
+                break;
+            case 'f':
+                failfast=true;
+                break;
             case 'h':
                 usage(argv[0]);
                 exit(1);
                 break;
+            case 'i':
+                coalesce_rows=parse_count(optarg, "coalesce");
+                break;
+            case 'k':
+                if(optarg == NULL)
+                    checkpoint_file[0]='\0';
+                else
+                    strncpy(checkpoint_file, optarg, sizeof(checkpoint_file));
+                break;
+            case 'L':
+                // takes two arguments, the table and then the file
+                if(optind >= argc) {
+                    fprintf(stderr, "Usage error: --loadcsv needs a table and a file\n");
+                    usage(argv[0]);
+                    exit(1);
+                }
+                strncpy(load_table, optarg, sizeof(load_table));
+                strncpy(load_file, argv[optind++], sizeof(load_file));
+                break;
             case 'o':
                 if(optarg == NULL)
                     oraclehome[0]='\0';
@@ -118,6 +199,18 @@ void parse_args(int argc, char *argv[]) {
                 else
                     strncpy(pw_program, optarg, sizeof(pw_program));
                 break;
+            case 'r':
+                failfast_rollback=true;
+                break;
+            case 'R':
+                resume=true;
+                break;
+            case 't':
+                if(optarg == NULL)
+                    trace_file[0]='\0';
+                else
+                    strncpy(trace_file, optarg, sizeof(trace_file));
+                break;
             case 'u':
                 if(optarg == NULL)
                     username_program[0]='\0';
@@ -150,6 +243,38 @@ void parse_args(int argc, char *argv[]) {
         show_usage_and_exit=true;
     }
 
+    if(failfast && *error_prefixes == '\0') {
+        fprintf(stderr, "Usage error: --failfast needs at least one error prefix (-e)\n");
+        show_usage_and_exit=true;
+    }
+
+    if(failfast_rollback && !failfast) {
+        fprintf(stderr, "Usage error: --rollback only makes sense with --failfast (-f)\n");
+        show_usage_and_exit=true;
+    }
+
+    if(resume && *checkpoint_file == '\0') {
+        fprintf(stderr, "Usage error: --resume needs a checkpoint file (-k)\n");
+        show_usage_and_exit=true;
+    }
+
+    if(commit_every > 0 && coalesce_rows == 0 && *load_table == '\0') {
+        fprintf(stderr, "Usage error: --commitevery only makes sense with --coalesce (-i) or --loadcsv (-L)\n");
+        show_usage_and_exit=true;
+    }
+
+    if(*load_table != '\0' && (*checkpoint_file != '\0' || resume)) {
+        fprintf(stderr, "Usage error: --loadcsv doesn't read stdin, so can't be used with --checkpoint (-k)\n");
+        show_usage_and_exit=true;
+    }
+
+    // checkpoint offsets are into stdin, which no longer lines up with what
+    // sqlplus runs once inserts have been merged
+    if(coalesce_rows > 0 && *load_table == '\0' && *checkpoint_file != '\0') {
+        fprintf(stderr, "Usage error: --coalesce can't be used with --checkpoint (-k)\n");
+        show_usage_and_exit=true;
+    }
+
     if(show_usage_and_exit) {
         usage(argv[0]);
         exit(1);
@@ -0,0 +1,245 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#define _GNU_SOURCE   // F_SETPIPE_SZ
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "safe_sqlplus.h"
+
+// Relay between our stdin/stdout/stderr and the sqlplus process when we need
+// to see what sqlplus prints (see need_output_relay()).  Everything is driven
+// from one poll(2) loop with the pipe into sqlplus set non-blocking, so we
+// never sit in write(2) while sqlplus is stuck writing output we haven't read.
+
+static struct errscan out_scan, err_scan;
+
+// write all of buf to a blocking fd
+static void write_all(int fd, const char *buf, size_t len) {
+    ssize_t n;
+    while(len > 0) {
+        if((n=write(fd, buf, len)) == -1) {
+            if(errno == EINTR)
+                continue;
+            return;   // nowhere left to send it
+        }
+        buf+=n;
+        len-=n;
+    }
+}
+
+static void relay_stdout(const char *buf, size_t len) {
+    char filtered[BUF_MAX+sizeof(CHECKPOINT_TAG)];
+    if(*checkpoint_file != '\0') {
+        len=checkpoint_filter(buf, len, filtered);
+        buf=filtered;
+    }
+    write_all(fileno(stdout), buf, len);
+}
+
+// Return: true if the failfast scanner tripped and we stopped feeding sqlplus
+bool relay_session(int sqlplus_in, int sqlplus_out, int sqlplus_err) {
+    char inbuf[BUF_MAX];
+    char outbuf[BUF_MAX];
+    const char *pending=inbuf;  // what we're in the middle of sending to sqlplus
+    size_t inlen=0, inoff=0, errpos;
+    bool feeding=true;    // still copying our stdin to sqlplus
+    bool tripped=false;
+    bool stopped=false;   // already reacted to tripped
+    ssize_t count;
+
+    if(fcntl(sqlplus_in, F_SETFL, fcntl(sqlplus_in, F_GETFL) | O_NONBLOCK) == -1) {
+        print_stacktrace();
+        PERROR("fcntl()");
+        exit(1);
+    }
+    if(failfast) {
+#ifdef F_SETPIPE_SZ
+        // whatever is already sitting in the pipe can't be taken back once an
+        // error shows up, so keep the pipe as small as the kernel allows
+        if(fcntl(sqlplus_in, F_SETPIPE_SZ, BUF_MAX) == -1 && debug) {
+            PERROR("fcntl(F_SETPIPE_SZ)");
+        }
+#else
+        if(debug)
+            fprintf(stderr, "failfast: can't shrink the pipe to sqlplus on this system\n");
+#endif
+        errscan_init(error_prefixes);
+        errscan_reset(&out_scan);
+        errscan_reset(&err_scan);
+    }
+
+    // on resume, set the session up the way the script had it first
+    if(*checkpoint_file != '\0' && resume)
+        pending=checkpoint_session(&inlen);
+
+    while(sqlplus_out != -1 || sqlplus_err != -1) {
+        struct pollfd pfds[4];
+        int nfds=0, in_idx=-1, pipe_idx=-1, out_idx=-1, err_idx=-1;
+        int timeout, ready;
+
+        // nothing left to send and no more coming, let sqlplus see EOF
+        if(sqlplus_in != -1 && !feeding && inoff == inlen) {
+            close(sqlplus_in);
+            sqlplus_in=-1;
+        }
+        // --loadcsv generates its input rather than reading stdin, one batch
+        // whenever the last one has been handed over
+        if(feeding && inoff == inlen && *load_table != '\0') {
+            inoff=0;
+            if((pending=csvload_next(&inlen)) == NULL) {
+                feeding=false;
+                inlen=0;
+                continue;
+            }
+        }
+        if(feeding && inoff == inlen) {
+            pfds[nfds].fd=fileno(stdin);
+            pfds[nfds].events=POLLIN;
+            in_idx=nfds++;
+        }
+        if(sqlplus_in != -1 && inoff < inlen) {
+            pfds[nfds].fd=sqlplus_in;
+            pfds[nfds].events=POLLOUT;
+            pipe_idx=nfds++;
+        }
+        if(sqlplus_out != -1) {
+            pfds[nfds].fd=sqlplus_out;
+            pfds[nfds].events=POLLIN;
+            out_idx=nfds++;
+        }
+        if(sqlplus_err != -1) {
+            pfds[nfds].fd=sqlplus_err;
+            pfds[nfds].events=POLLIN;
+            err_idx=nfds++;
+        }
+        // rows held by the insert rewriter go out if stdin stalls
+        timeout=-1;
+        if(coalesce_rows > 0 && in_idx != -1 && coalesce_holding())
+            timeout=COALESCE_IDLE_MS;
+        if((ready=poll(pfds, nfds, timeout)) == -1) {
+            if(errno == EINTR)
+                continue;
+            print_stacktrace();
+            PERROR("poll()");
+            exit(1);
+        }
+        if(ready == 0) {
+            pending=coalesce_flush(&inlen);
+            inoff=0;
+            continue;
+        }
+
+        if(in_idx != -1 && pfds[in_idx].revents != 0) {
+            if((count=read(fileno(stdin), inbuf, sizeof(inbuf))) > 0) {
+                if(*trace_file != '\0')
+                    trace_stdin(inbuf, count);
+                if(*checkpoint_file != '\0') {
+                    pending=checkpoint_track(inbuf, count, &inlen);
+                } else if(coalesce_rows > 0) {
+                    pending=coalesce_feed(inbuf, count, &inlen);
+                } else {
+                    pending=inbuf;
+                    inlen=count;
+                }
+                inoff=0;
+            } else if(count == 0 || errno != EINTR) {
+                feeding=false;
+                if(coalesce_rows > 0) {
+                    pending=coalesce_finish(&inlen);
+                    inoff=0;
+                }
+            }
+        }
+        if(pipe_idx != -1 && pfds[pipe_idx].revents != 0) {
+            if((count=write(sqlplus_in, pending+inoff, inlen-inoff)) > 0) {
+                inoff+=count;
+                if(*trace_file != '\0')
+                    trace_sent(count);
+            } else if(count == -1 && errno != EAGAIN && errno != EINTR) {
+                // sqlplus went away (EPIPE), stop sending it anything
+                feeding=false;
+                inlen=inoff=0;
+            }
+        }
+        if(out_idx != -1 && pfds[out_idx].revents != 0) {
+            if((count=read(sqlplus_out, outbuf, sizeof(outbuf))) > 0) {
+                if(*trace_file != '\0')
+                    trace_output(TRACE_STDOUT, outbuf, count);
+                errpos=0;
+                if(failfast && !tripped && (errpos=errscan_feed(&out_scan, outbuf, count)) != 0) {
+                    // checkpoints printed after the error must not count
+                    relay_stdout(outbuf, errpos);
+                    checkpoint_freeze();
+                    tripped=true;
+                }
+                relay_stdout(outbuf+errpos, count-errpos);
+            } else if(count == 0 || errno != EINTR) {
+                close(sqlplus_out);
+                sqlplus_out=-1;
+            }
+        }
+        if(err_idx != -1 && pfds[err_idx].revents != 0) {
+            if((count=read(sqlplus_err, outbuf, sizeof(outbuf))) > 0) {
+                if(*trace_file != '\0')
+                    trace_output(TRACE_STDERR, outbuf, count);
+                write_all(fileno(stderr), outbuf, count);
+                if(failfast && !tripped && errscan_feed(&err_scan, outbuf, count) != 0) {
+                    checkpoint_freeze();
+                    tripped=true;
+                }
+            } else if(count == 0 || errno != EINTR) {
+                close(sqlplus_err);
+                sqlplus_err=-1;
+            }
+        }
+
+        if(tripped && !stopped) {
+            // drop whatever we haven't handed to sqlplus yet and stop reading stdin
+            if(debug)
+                fprintf(stderr, "failfast: error prefix seen in sqlplus output, no longer feeding stdin\n");
+            stopped=true;
+            feeding=false;
+            inlen=inoff=0;
+            if(failfast_rollback && sqlplus_in != -1) {
+                pending=FAILFAST_ROLLBACK;
+                inlen=strlen(FAILFAST_ROLLBACK);
+            }
+        }
+    }
+    if(sqlplus_in != -1)
+        close(sqlplus_in);
+    return tripped;
+}
@@ -0,0 +1,285 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "safe_sqlplus.h"
+
+// sqlplus_replay - play back a trace written by safe_sqlplus --record
+//
+// Run as "sqlplus_replay [-s speed] tracefile" it writes the recorded stdin
+// to stdout with the recorded timing, to be piped into safe_sqlplus.
+//
+// Run under the name "sqlplus" (symlink it to ORACLE_HOME/bin/sqlplus in a
+// scratch directory and point safe_sqlplus -o at that) it stands in for
+// sqlplus: the trace and speed come from SAFE_SQLPLUS_TRACE and
+// SAFE_SQLPLUS_SPEED, stdin is read and thrown away, and the recorded output
+// is written back with the recorded timing.  Each output chunk also waits
+// until as much input has arrived as sqlplus had been sent when it printed
+// that chunk, so output still trails input the way it did against the
+// database.  Exits with the status sqlplus exited with.
+//
+// speed is a multiplier for how fast to go, 1 is real time, 0 means don't
+// wait at all.
+
+struct trace_rec {
+    char type;
+    unsigned long long delta;   // microseconds
+    unsigned long long len;
+    char *data;
+};
+
+static double speed=1.0;
+static unsigned long long consumed;   // stand-in: bytes read from stdin
+static bool stdin_eof;
+
+void usage(char *argv0) {
+    printf("usage: %s [-s speed] tracefile\n", argv0);
+    printf(" Write the stdin recorded by safe_sqlplus --record to stdout\n");
+    printf(" -s speed               Playback speed, 1 is real time (default), 10 is ten times faster\n");
+    printf("                        and 0 is as fast as possible\n");
+    printf("When run as \"sqlplus\", stand in for sqlplus, replaying the recorded output of the trace\n");
+    printf("named by the SAFE_SQLPLUS_TRACE environment variable at SAFE_SQLPLUS_SPEED\n");
+}
+
+static bool get_varint(FILE *f, unsigned long long *n) {
+    int c, shift=0;
+    *n=0;
+    do {
+        if((c=getc(f)) == EOF || shift > 63)
+            return false;
+        *n|=(unsigned long long)(c & 0x7f) << shift;
+        shift+=7;
+    } while(c & 0x80);
+    return true;
+}
+
+static FILE *open_trace(char *path) {
+    FILE *f;
+    char magic[sizeof(TRACE_MAGIC)];
+    char logbuf[LOGBUF_MAX];
+
+    if((f=fopen(path, "r")) == NULL) {
+        snprintf(logbuf, sizeof(logbuf), "Unable to open trace file \"%s\"", path);
+        PERROR(logbuf);
+        exit(1);
+    }
+    if(fread(magic, 1, strlen(TRACE_MAGIC), f) != strlen(TRACE_MAGIC) ||
+       memcmp(magic, TRACE_MAGIC, strlen(TRACE_MAGIC)) != 0) {
+        fprintf(stderr, "\"%s\" is not a safe_sqlplus trace\n", path);
+        exit(1);
+    }
+    return f;
+}
+
+// Return: false at the end of the trace
+static bool next_rec(FILE *f, struct trace_rec *r) {
+    static size_t cap;
+    int c;
+
+    if((c=getc(f)) == EOF)
+        return false;
+    r->type=c;
+    if(!get_varint(f, &r->delta) || !get_varint(f, &r->len)) {
+        fprintf(stderr, "Trace is truncated\n");
+        exit(1);
+    }
+    if(r->type != TRACE_STDIN && r->type != TRACE_STDOUT && r->type != TRACE_STDERR)
+        return true;   // no data follows
+    if(r->len > cap) {
+        cap=r->len;
+        if((r->data=realloc(r->data, cap)) == NULL) {
+            PERROR("realloc()");
+            exit(1);
+        }
+    }
+    if(fread(r->data, 1, r->len, f) != r->len) {
+        fprintf(stderr, "Trace is truncated\n");
+        exit(1);
+    }
+    return true;
+}
+
+static void now(struct timespec *t) {
+    clock_gettime(CLOCK_MONOTONIC, t);
+}
+
+// Return: base plus delta microseconds of trace time, scaled by speed
+static struct timespec after(struct timespec base, unsigned long long delta) {
+    long long ns;
+    if(speed <= 0)
+        return base;
+    ns=(long long)(delta*1000/speed);
+    base.tv_sec+=ns/1000000000LL;
+    base.tv_nsec+=ns%1000000000LL;
+    if(base.tv_nsec >= 1000000000L) {
+        base.tv_sec++;
+        base.tv_nsec-=1000000000L;
+    }
+    return base;
+}
+
+// Return: milliseconds from now to t, 0 if it has passed
+static int ms_until(struct timespec *t) {
+    struct timespec n;
+    long long ms;
+    now(&n);
+    ms=(t->tv_sec-n.tv_sec)*1000LL+(t->tv_nsec-n.tv_nsec+999999)/1000000;
+    return ms > 0 ? (int)ms : 0;
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+    ssize_t n;
+    while(len > 0) {
+        if((n=write(fd, buf, len)) == -1) {
+            if(errno == EINTR)
+                continue;
+            exit(1);   // reader went away
+        }
+        buf+=n;
+        len-=n;
+    }
+}
+
+// stand-in: read and discard stdin until the deadline has passed and at
+// least need bytes have come in (or there is no more coming)
+static void wait_for(struct timespec *deadline, unsigned long long need) {
+    char buf[BUF_MAX*16];
+    struct pollfd pfd;
+    ssize_t count;
+    int timeout;
+
+    while(1) {
+        bool input_done=stdin_eof || consumed >= need;
+        timeout=ms_until(deadline);
+        if(input_done && timeout == 0)
+            return;
+        if(stdin_eof) {
+            poll(NULL, 0, timeout);
+            continue;
+        }
+        pfd.fd=fileno(stdin);
+        pfd.events=POLLIN;
+        if(poll(&pfd, 1, input_done ? timeout : -1) > 0) {
+            if((count=read(fileno(stdin), buf, sizeof(buf))) > 0)
+                consumed+=count;
+            else if(count == 0 || errno != EINTR)
+                stdin_eof=true;
+        }
+    }
+}
+
+static int stand_in(void) {
+    char *path, *s;
+    FILE *f;
+    struct trace_rec r={0};
+    struct timespec last, deadline;
+    unsigned long long sent=0, pending_delta=0;
+
+    if((path=getenv("SAFE_SQLPLUS_TRACE")) == NULL) {
+        fprintf(stderr, "sqlplus_replay: set SAFE_SQLPLUS_TRACE to the trace to replay\n");
+        return 1;
+    }
+    if((s=getenv("SAFE_SQLPLUS_SPEED")) != NULL)
+        speed=atof(s);
+    f=open_trace(path);
+    now(&last);
+    while(next_rec(f, &r)) {
+        pending_delta+=r.delta;
+        switch(r.type) {
+            case TRACE_SENT:
+                sent+=r.len;
+                break;
+            case TRACE_STDOUT:
+            case TRACE_STDERR:
+                deadline=after(last, pending_delta);
+                wait_for(&deadline, sent);
+                write_all(r.type == TRACE_STDOUT ? fileno(stdout) : fileno(stderr), r.data, r.len);
+                now(&last);
+                pending_delta=0;
+                break;
+            case TRACE_EXIT:
+                deadline=after(last, pending_delta);
+                wait_for(&deadline, sent);
+                return (int)r.len;
+        }
+    }
+    return 0;
+}
+
+static int driver(char *path) {
+    FILE *f;
+    struct trace_rec r={0};
+    struct timespec start, deadline;
+    unsigned long long elapsed=0;
+
+    f=open_trace(path);
+    now(&start);
+    while(next_rec(f, &r)) {
+        elapsed+=r.delta;
+        if(r.type != TRACE_STDIN)
+            continue;
+        deadline=after(start, elapsed);
+        poll(NULL, 0, ms_until(&deadline));
+        write_all(fileno(stdout), r.data, r.len);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    char *base;
+    int c;
+
+    base=strrchr(argv[0], '/') != NULL ? strrchr(argv[0], '/')+1 : argv[0];
+    if(strcmp(base, "sqlplus") == 0)
+        return stand_in();
+
+    while((c=getopt(argc, argv, "hs:")) != -1) {
+        switch(c) {
+            case 's':
+                speed=atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+    if(optind != argc-1) {
+        usage(argv[0]);
+        exit(1);
+    }
+    return driver(argv[optind]);
+}
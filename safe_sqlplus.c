@@ -251,6 +251,14 @@ int realloc_if_needed(char *s, int capacity) {
     return new_capacity;
 }
 
+// sqlplus normally writes straight to our stdout/stderr and gets our stdin copied
+// to it as is.  Features that have to look at what sqlplus prints, or change what
+// it is fed, run the session through relay_session() instead
+bool need_output_relay(void) {
+    return failfast || *checkpoint_file != '\0' || coalesce_rows > 0 || *load_table != '\0' ||
+           *trace_file != '\0';
+}
+
 char *make_connect_str(char *template, char *username, char *password) {
     char *pt, *pcs, *pu, *pp; // ptrs to template, connect string, username, password
     char *cs;   //connect string
@@ -323,9 +331,14 @@ char *make_connect_str(char *template, char *username, char *password) {
 }
 
 int main(int argc, char *argv[]) {
-    pid_t username_pid, pw_pid, sqlplus_pid;
+    pid_t username_pid, pw_pid, sqlplus_pid, waited;
     int count, status;
     int fds[2]={-1, -1};
+    int out_fds[2]={-1, -1};
+    int err_fds[2]={-1, -1};
+    int sqlplus_in;
+    bool relay, tripped;
+    off_t start_offset;
     char buf[BUF_MAX];
     char logbuf[LOGBUF_MAX];
     char ora_username[USERNAME_MAX];
@@ -348,6 +361,21 @@ int main(int argc, char *argv[]) {
 
     parse_args(argc, argv);
 
+    // open and check the CSV file before logging in
+    if(*load_table != '\0')
+        csvload_open(load_table, load_file);
+
+    // pick up where the last run left off before going to the trouble of logging in
+    if(*checkpoint_file != '\0') {
+        start_offset=checkpoint_open(checkpoint_file, resume);
+        if(resume && lseek(fileno(stdin), start_offset, SEEK_SET) == -1) {
+            print_stacktrace();
+            fprintf(stderr, "Could not seek stdin to resume from the checkpoint (stdin must be a file)\n");
+            PERROR("lseek()");
+            exit(1);
+        }
+    }
+
     // get the Oracle sqlplus username
     memset(ora_username, 0, USERNAME_MAX);
     if((username_args=make_args(username_program)) == NULL) {
@@ -469,6 +497,23 @@ int main(int argc, char *argv[]) {
         PERROR("pipe()");
         return 1;
     }
+    // opened only now so the username and password programs don't inherit it
+    if(*trace_file != '\0')
+        trace_open(trace_file);
+
+    relay=need_output_relay();
+    if(relay) {
+        if(pipe(out_fds) == -1 || pipe(err_fds) == -1) {
+            print_stacktrace();
+            PERROR("pipe()");
+            return 1;
+        }
+        // relay_session() notices sqlplus exiting when its output pipes close and
+        // reaps it itself; don't let the SIGCHLD handler exit out from under it.
+        // A write to a dead sqlplus should come back as EPIPE, not kill us.
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGPIPE, SIG_IGN);
+    }
     snprintf(sqlplus_program, sizeof(sqlplus_program), "%s/bin/sqlplus %s /NOLOG", oraclehome, sqlplusargs);
     if((sqlplus_args=make_args(sqlplus_program)) == NULL) {
         print_stacktrace();
@@ -484,8 +529,16 @@ int main(int argc, char *argv[]) {
     if(sqlplus_pid > 0) {
         // parent
         close(fds[0]);                // close read side of pipe
-        dup2(fds[1], fileno(stdout)); // wire up stdout (fd 1) to write side of the pipe (fds[1])
-        close(fds[1]);
+        if(relay) {
+            // keep our stdout for sqlplus output, talk to sqlplus through the pipe directly
+            sqlplus_in=fds[1];
+            close(out_fds[1]);
+            close(err_fds[1]);
+        } else {
+            dup2(fds[1], fileno(stdout)); // wire up stdout (fd 1) to write side of the pipe (fds[1])
+            close(fds[1]);
+            sqlplus_in=fileno(stdout);
+        }
         char *spool_begin="spool ";
         char *spool_session_log=SQLPLUS_SESSION_LOG;
         char *spool_end=";\n";
@@ -496,16 +549,16 @@ int main(int argc, char *argv[]) {
         connect_str=make_connect_str(connect_template, ora_username, ora_pw);
         if(debug) {
             fprintf(stderr, "Logging sqlplus session to: %s\n", SQLPLUS_SESSION_LOG);
-            write(fileno(stdout), spool_begin, strlen(spool_begin));
-            write(fileno(stdout), spool_session_log, strlen(spool_session_log));
-            write(fileno(stdout), spool_end, strlen(spool_end));
+            write(sqlplus_in, spool_begin, strlen(spool_begin));
+            write(sqlplus_in, spool_session_log, strlen(spool_session_log));
+            write(sqlplus_in, spool_end, strlen(spool_end));
             fprintf(stderr, "Sending to sqlplus (without the brackets): [connect %s]\n", connect_str);
         }
-        write(fileno(stdout), define_off, strlen(define_off));
-        write(fileno(stdout), connect_start, strlen(connect_start));
-        write(fileno(stdout), connect_str, strlen(connect_str));
-        write(fileno(stdout), connect_end, strlen(connect_end));
-        write(fileno(stdout), define_on, strlen(define_on));
+        write(sqlplus_in, define_off, strlen(define_off));
+        write(sqlplus_in, connect_start, strlen(connect_start));
+        write(sqlplus_in, connect_str, strlen(connect_str));
+        write(sqlplus_in, connect_end, strlen(connect_end));
+        write(sqlplus_in, define_on, strlen(define_on));
         fflush(stdout);
         // zero username/password/connect string to prevent someone from reading them from memory
         memset(ora_username, 0, sizeof(ora_username));
@@ -513,16 +566,38 @@ int main(int argc, char *argv[]) {
         char *pcs;
         for(pcs=connect_str; *pcs != '\0'; pcs++)
             *pcs = '\0';
-        // copy stdin to the write side of pipe (this read(2) will block)
-        while((count=read(fileno(stdin), buf, BUF_MAX)) > 0) {
-            write(fileno(stdout), buf, count);
+        tripped=false;
+        if(relay) {
+            tripped=relay_session(sqlplus_in, out_fds[0], err_fds[0]);
+        } else {
+            // copy stdin to the write side of pipe (this read(2) will block)
+            while((count=read(fileno(stdin), buf, BUF_MAX)) > 0) {
+                write(sqlplus_in, buf, count);
+            }
         }
         status=0;
-        if(waitpid(sqlplus_pid, &status, 0) == -1) {
+        waited=waitpid(sqlplus_pid, &status, 0);
+        if(*trace_file != '\0')
+            trace_close(waited != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        if(*checkpoint_file != '\0')
+            checkpoint_close(waited != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        if(waited == -1) {
             print_stacktrace();
             fprintf(stderr, "Failed to wait on sqlplus program\n");
             PERROR("waitpid(sqlplus_pid, &status, 0)");
             fflush(stderr);
+        } else if(tripped) {
+            fprintf(stderr, "Stopped feeding sqlplus after it reported an error (sqlplus returned %d)\n", WEXITSTATUS(status));
+            fflush(stderr);
+            exit(FAILFAST_EXIT);
+        } else if(*load_table != '\0' && csvload_failed()) {
+            fprintf(stderr, "Stopped loading %s at a bad record\n", load_file);
+            fflush(stderr);
+            exit(1);
+        } else if(*load_table != '\0' && WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Stopped loading %s, Oracle rejected a batch (sqlplus returned %d)\n", load_file, WEXITSTATUS(status));
+            fflush(stderr);
+            exit(WEXITSTATUS(status));
         } else if(WIFEXITED(status) && WEXITSTATUS(status) != 0) {
             fprintf(stderr, "Failed to execute sqlplus program (it returned %d)\n", WEXITSTATUS(status));
             fflush(stderr);
@@ -534,6 +609,14 @@ int main(int argc, char *argv[]) {
         dup2(fds[0], fileno(stdin)); // wire up fd 0 to read side of pipe
         close(fds[0]);
         close(fds[1]);
+        if(relay) {
+            dup2(out_fds[1], fileno(stdout));
+            dup2(err_fds[1], fileno(stderr));
+            close(out_fds[0]);
+            close(out_fds[1]);
+            close(err_fds[0]);
+            close(err_fds[1]);
+        }
 
         setenv("ORACLE_HOME", oraclehome, 1);
         if(debug)
@@ -30,6 +30,7 @@
 // Sat May  3 22:46:30 MDT 2014
 //
 #include <stdbool.h>
+#include <sys/types.h>
 
 #define PERROR(s)  fprintf(stderr, "Error at %s:%d:%s(): ", __FILE__, __LINE__, __FUNCTION__); perror(s);
 
@@ -45,6 +46,33 @@
 #define CONNECTTEMPLATE_MAX  8192
 #define SQLPLUS_ARGS_MAX     8192
 #define SQLPLUS_SESSION_LOG  "./sqlplus_session.log"
+#define ERROR_PREFIXES_MAX   1024
+#define ERROR_PREFIXES       "ORA-,SP2-"
+#define FAILFAST_EXIT        100
+// input may have been cut off mid statement, so end the line and throw away
+// sqlplus' partial buffer with "." before anything is run
+#define FAILFAST_ROLLBACK    "\n.\nrollback;\nexit failure rollback\n"
+#define CHECKPOINT_FILE_MAX  4096
+#define CHECKPOINT_STATE_LEN 42      // "%20llu %20llu\n"
+#define CHECKPOINT_SYNC_EVERY 1000
+#define CHECKPOINT_TAG       "#safe_sqlplus-checkpoint#"
+#define STMT_LINE_MAX        256
+#define COALESCE_MAX_VALUES  999     // Oracle's limit on columns across all INTO clauses
+#define COALESCE_IDLE_MS     200
+#define TABLE_MAX            512
+#define CSV_FILE_MAX         4096
+#define CSV_COLUMNS_MAX      1000
+#define CSV_LINE_MAX         1000    // well under sqlplus' input line limit
+#define CSV_BATCH_ROWS       100
+#define CSV_COMMIT_EVERY     10000
+#define TRACE_FILE_MAX       4096
+#define TRACE_LINE_MAX       4096
+#define TRACE_MAGIC          "SSQLTRC1"
+#define TRACE_STDIN          'i'     // what we read on stdin, credentials redacted
+#define TRACE_SENT           's'     // bytes written to sqlplus stdin
+#define TRACE_STDOUT         'o'     // sqlplus stdout
+#define TRACE_STDERR         'e'     // sqlplus stderr
+#define TRACE_EXIT           'x'     // sqlplus exit status
 
 bool debug;
 char connect_template[CONNECTTEMPLATE_MAX];
@@ -52,8 +80,61 @@ char oraclehome[ORACLEHOME_MAX];
 char pw_program[PW_PROGRAM_MAX];
 char username_program[USERNAME_PROGRAM_MAX];
 char sqlplusargs[SQLPLUS_ARGS_MAX];
+bool failfast;
+bool failfast_rollback;
+char error_prefixes[ERROR_PREFIXES_MAX];
+char checkpoint_file[CHECKPOINT_FILE_MAX];
+bool resume;
+int coalesce_rows;
+int commit_every;
+char load_table[TABLE_MAX];
+char load_file[CSV_FILE_MAX];
+char trace_file[TRACE_FILE_MAX];
+
+struct errscan {
+    int state;
+};
+
+enum stmt_kind {
+    STMT_NONE,        // between statements
+    STMT_UNDECIDED,   // CREATE [OR REPLACE] seen, don't know if it's PL/SQL yet
+    STMT_COMMAND,     // sqlplus command continued onto the next line with '-'
+    STMT_SQL,
+    STMT_PLSQL
+};
+
+struct stmt_splitter {
+    enum stmt_kind kind;
+    char head[STMT_LINE_MAX];  // first words of the current statement
+};
 
 void usage(char *argv0);
 void parse_args(int argc, char *argv[]);
 void print_stacktrace(void);
+void errscan_init(char *prefixes);
+void errscan_reset(struct errscan *es);
+size_t errscan_feed(struct errscan *es, const char *buf, size_t len);
+bool word_is(char *s, char *word);
+char *next_word(char *s);
+void append(char **buf, size_t *len, size_t *cap, const char *s, size_t n);
+bool stmt_end_of_line(struct stmt_splitter *sp, char *line, char last_nonspace);
+off_t checkpoint_open(char *path, bool resume);
+void checkpoint_close(bool sqlplus_ok);
+void checkpoint_freeze(void);
+char *checkpoint_session(size_t *outlen);
+char *checkpoint_track(const char *buf, size_t len, size_t *outlen);
+size_t checkpoint_filter(const char *buf, size_t len, char *out);
+char *coalesce_feed(const char *buf, size_t len, size_t *outlen);
+char *coalesce_flush(size_t *outlen);
+char *coalesce_finish(size_t *outlen);
+bool coalesce_holding(void);
+void csvload_open(char *table, char *path);
+char *csvload_next(size_t *outlen);
+bool csvload_failed(void);
+void trace_open(char *path);
+void trace_stdin(const char *buf, size_t len);
+void trace_sent(size_t len);
+void trace_output(char type, const char *buf, size_t len);
+void trace_close(int status);
+bool relay_session(int sqlplus_in, int sqlplus_out, int sqlplus_err);
 
@@ -0,0 +1,157 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "safe_sqlplus.h"
+
+// Splits a script into statements the way sqlplus would, closely enough for
+// generated scripts.  It is line based: SQL ends at a line ending in ';',
+// PL/SQL (DECLARE, BEGIN, CREATE PROCEDURE/FUNCTION/PACKAGE/TRIGGER/TYPE) ends
+// at a line holding only '/', and sqlplus commands (SET, SPOOL, @file, ...)
+// are one line each unless it ends in the '-' continuation char.
+
+static char *sqlplus_commands[]={
+    "ACC", "ACCEPT", "BRE", "BREAK", "BTI", "BTITLE", "CL", "CLEAR", "COL", "COLUMN",
+    "COMP", "COMPUTE", "CONN", "CONNECT", "DEF", "DEFINE", "DESC", "DESCRIBE", "DISC",
+    "DISCONNECT", "EXEC", "EXECUTE", "EXIT", "HO", "HOST", "PAU", "PAUSE", "PRI", "PRINT",
+    "PRO", "PROMPT", "QUIT", "SET", "SHO", "SHOW", "SPO", "SPOOL", "STA", "START",
+    "TIMI", "TIMING", "TTI", "TTITLE", "UNDEF", "UNDEFINE", "VAR", "VARIABLE",
+    "WHENEVER", NULL
+};
+
+static char *plsql_units[]={
+    "FUNCTION", "LIBRARY", "PACKAGE", "PROCEDURE", "TRIGGER", "TYPE", NULL
+};
+
+// compare the start of s to word, case insensitively, up to a word boundary
+bool word_is(char *s, char *word) {
+    size_t len=strlen(word);
+    return strncasecmp(s, word, len) == 0 && (s[len] == '\0' || isspace((unsigned char)s[len]) || s[len] == ';');
+}
+
+char *next_word(char *s) {
+    while(*s != '\0' && !isspace((unsigned char)*s))
+        s++;
+    while(isspace((unsigned char)*s))
+        s++;
+    return s;
+}
+
+static enum stmt_kind classify(char *head) {
+    char *w=head;
+    if(word_is(w, "DECLARE") || word_is(w, "BEGIN"))
+        return STMT_PLSQL;
+    if(!word_is(w, "CREATE"))
+        return STMT_SQL;
+    w=next_word(w);
+    if(word_is(w, "OR")) {
+        w=next_word(w);
+        if(word_is(w, "REPLACE"))
+            w=next_word(w);
+    }
+    if(word_is(w, "EDITIONABLE") || word_is(w, "NONEDITIONABLE"))
+        w=next_word(w);
+    if(*w == '\0')
+        return STMT_UNDECIDED;
+    for(char **unit=plsql_units; *unit != NULL; unit++) {
+        if(word_is(w, *unit))
+            return STMT_PLSQL;
+    }
+    return STMT_SQL;
+}
+
+// Call at each newline of the input with the start of the line (it doesn't
+// have to be all of it) and the last non blank char on it.
+// Return: true if the line just finished ends a statement
+bool stmt_end_of_line(struct stmt_splitter *sp, char *line, char last_nonspace) {
+    char *l;
+    size_t head_len;
+    bool command;
+
+    if(sp->kind == STMT_COMMAND) {
+        if(last_nonspace == '-')
+            return false;
+        sp->kind=STMT_NONE;
+        return true;
+    }
+    for(l=line; isspace((unsigned char)*l); l++)
+        ;
+    if(l[0] == '/' && (l[1] == '\0' || isspace((unsigned char)l[1]))) {
+        sp->kind=STMT_NONE;  // run the buffer
+        return true;
+    }
+    if(sp->kind == STMT_NONE) {
+        if(*l == '\0' || strncmp(l, "--", 2) == 0 || word_is(l, "REM") || word_is(l, "REMARK"))
+            return false;
+        command=*l == '@';
+        for(char **cmd=sqlplus_commands; !command && *cmd != NULL; cmd++)
+            command=word_is(l, *cmd);
+        if(command) {
+            if(last_nonspace == '-') {
+                sp->kind=STMT_COMMAND;
+                return false;
+            }
+            return true;
+        }
+        sp->head[0]='\0';
+        sp->kind=STMT_UNDECIDED;
+    }
+    if(sp->kind == STMT_UNDECIDED) {
+        head_len=strlen(sp->head);
+        snprintf(sp->head+head_len, sizeof(sp->head)-head_len, "%s%s", head_len > 0 ? " " : "", l);
+        sp->kind=classify(sp->head);
+    }
+    if(sp->kind == STMT_SQL && last_nonspace == ';') {
+        sp->kind=STMT_NONE;
+        return true;
+    }
+    return false;
+}
+
+// Append n bytes of s to the growable buffer *buf, which holds *len bytes
+// in *cap bytes of space, reallocating as needed
+void append(char **buf, size_t *len, size_t *cap, const char *s, size_t n) {
+    if(*len+n > *cap) {
+        while(*len+n > *cap)
+            *cap=*cap == 0 ? BUF_MAX*2 : *cap*2;
+        if((*buf=realloc(*buf, *cap)) == NULL) {
+            print_stacktrace();
+            PERROR("realloc()");
+            exit(1);
+        }
+    }
+    memcpy(*buf+*len, s, n);
+    *len+=n;
+}
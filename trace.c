@@ -0,0 +1,253 @@
+//                                                                                               
+// safe_sqlplus - prevents having to specify password on command line
+//                when invoking sqlplus
+//
+// Copyright (C) 2014 Ryan A. Chapman. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   1. Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//   2. Redistributions in binary form must reproduce the above copyright notice, 
+//      this list of conditions and the following disclaimer in the documentation
+//      and/or other materials provided with the distribution.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHORS
+// OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Ryan A. Chapman, ryan@rchapman.org
+// Sat May  3 22:46:30 MDT 2014
+//
+#define _GNU_SOURCE   // strcasestr()
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "safe_sqlplus.h"
+
+// --record: write a binary trace of the session for sqlplus_replay.
+//
+// The file starts with TRACE_MAGIC, then one record per event:
+//
+//     type         1 byte, TRACE_STDIN/SENT/STDOUT/STDERR/EXIT
+//     delta        varint, microseconds since the previous record
+//     len          varint, bytes of data (SENT: bytes written to sqlplus,
+//                  EXIT: sqlplus exit status, no data follows either)
+//     data         len bytes
+//
+// varints are little endian base 128.  Text on stdin and from sqlplus is
+// recorded with the rest of any CONNECT or PASSWORD line, and anything after
+// IDENTIFIED BY, replaced with <redacted> (sqlplus echoes commands back when
+// running a script with SET ECHO ON).  On stdin, the lines answering the
+// prompts sqlplus gives after a CONNECT without a password, or after
+// PASSWORD, are redacted as a whole.  The login we send sqlplus ourselves is
+// never recorded.
+
+// line by line redaction state for one stream
+struct redactor {
+    char held[TRACE_LINE_MAX];      // start of the line we're on
+    size_t held_len;
+    bool dropping;                  // rest of this line is redacted
+    bool passing;                   // rest of this line is clean
+    bool prompts;                   // sqlplus reads its password prompts from this stream
+    int secret_lines;               // lines still to come that answer a password prompt
+};
+
+static FILE *trace;
+static struct timespec last;
+static struct redactor in_redactor, out_redactor, err_redactor;
+static char *out;
+static size_t out_len, out_cap;
+
+static void put_varint(unsigned long long n) {
+    do {
+        unsigned char b=n & 0x7f;
+        n>>=7;
+        if(n != 0)
+            b|=0x80;
+        putc(b, trace);
+    } while(n != 0);
+}
+
+static void put_record(char type, const char *buf, size_t len) {
+    struct timespec now;
+    long long delta;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    delta=(now.tv_sec-last.tv_sec)*1000000LL+(now.tv_nsec-last.tv_nsec)/1000;
+    last=now;
+    putc(type, trace);
+    put_varint(delta > 0 ? delta : 0);
+    put_varint(len);
+    if(buf != NULL && fwrite(buf, 1, len, trace) != len) {
+        PERROR("fwrite()");
+        exit(1);
+    }
+}
+
+void trace_open(char *path) {
+    char logbuf[LOGBUF_MAX];
+    int fd;
+
+    // the trace holds everything typed into sqlplus, keep it private
+    if((fd=open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600)) == -1 || (trace=fdopen(fd, "w")) == NULL) {
+        snprintf(logbuf, sizeof(logbuf), "Unable to open trace file \"%s\"", path);
+        PERROR(logbuf);
+        exit(1);
+    }
+    setvbuf(trace, NULL, _IOFBF, 1<<16);
+    in_redactor.prompts=true;
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace);
+    // nothing buffered for a forked sqlplus that fails to exec to write out again
+    fflush(trace);
+    clock_gettime(CLOCK_MONOTONIC, &last);
+}
+
+static void emit(const char *s, size_t n) {
+    append(&out, &out_len, &out_cap, s, n);
+}
+
+// Return: true if the line in held carried a secret (held is trimmed to what is safe to keep)
+static bool redact(struct redactor *rd) {
+    char *l, *by;
+    char *secret=NULL;
+
+    rd->held[rd->held_len]='\0';
+    for(l=rd->held; isspace((unsigned char)*l); l++)
+        ;
+    // echoed commands come back after the prompt
+    while(strncmp(l, "SQL> ", 5) == 0)
+        l+=5;
+    if(word_is(l, "CONN") || word_is(l, "CONNECT") || word_is(l, "PASSW") || word_is(l, "PASSWORD")) {
+        secret=l;
+        while(*secret != '\0' && !isspace((unsigned char)*secret) && *secret != ';')
+            secret++;
+        if(rd->prompts) {
+            char *rest=next_word(l);
+            if(word_is(l, "PASSW") || word_is(l, "PASSWORD"))
+                rd->secret_lines=3;   // old, new and retyped new password
+            else if(*rest == '\0' || *rest == ';')
+                rd->secret_lines=2;   // user name (maybe with password), then password
+            else if(strchr(rest, '/') == NULL)
+                rd->secret_lines=1;   // password
+        }
+    } else {
+        for(by=rd->held; (by=strcasestr(by, "IDENTIFIED")) != NULL; by++) {
+            if(word_is(next_word(by), "BY")) {
+                secret=next_word(by)+2;
+                break;
+            }
+        }
+    }
+    if(secret == NULL)
+        return false;
+    rd->held_len=secret-rd->held;
+    return true;
+}
+
+static void emit_held(struct redactor *rd) {
+    bool secret;
+
+    if(rd->secret_lines > 0) {
+        // answer to a password prompt, none of it is safe
+        rd->held[rd->held_len]='\0';
+        if(rd->secret_lines == 2 && strchr(rd->held, '/') != NULL)
+            rd->secret_lines=0;   // user/password given at the user name prompt
+        else
+            rd->secret_lines--;
+        emit("<redacted>", 10);
+        secret=true;
+    } else {
+        secret=redact(rd);
+        emit(rd->held, rd->held_len);
+        if(secret)
+            emit(" <redacted>", 11);
+    }
+    rd->held_len=0;
+    rd->dropping=secret;
+    rd->passing=!secret;
+}
+
+// Record a chunk of a text stream, less anything that looks like a password.
+// The start of each line is held back until we know it's safe.
+static void record_text(char type, struct redactor *rd, const char *buf, size_t len) {
+    const char *p=buf, *end=buf+len;
+
+    out_len=0;
+    while(p < end) {
+        const char *nl=memchr(p, '\n', end-p);
+        const char *stop=nl != NULL ? nl : end;
+        if(rd->passing) {
+            emit(p, stop-p);
+        } else if(!rd->dropping) {
+            size_t room=sizeof(rd->held)-1-rd->held_len;
+            size_t n=(size_t)(stop-p) < room ? (size_t)(stop-p) : room;
+            memcpy(rd->held+rd->held_len, p, n);
+            rd->held_len+=n;
+            if(rd->held_len == sizeof(rd->held)-1) {
+                emit_held(rd);
+                if(rd->passing)
+                    emit(p+n, stop-(p+n));
+            }
+        }
+        if(nl == NULL)
+            break;
+        if(!rd->passing && !rd->dropping)
+            emit_held(rd);
+        emit("\n", 1);
+        rd->passing=rd->dropping=false;
+        p=nl+1;
+    }
+    if(out_len > 0)
+        put_record(type, out, out_len);
+}
+
+static void flush_text(char type, struct redactor *rd) {
+    if(rd->held_len == 0)
+        return;
+    out_len=0;
+    emit_held(rd);
+    put_record(type, out, out_len);
+}
+
+void trace_stdin(const char *buf, size_t len) {
+    record_text(TRACE_STDIN, &in_redactor, buf, len);
+}
+
+void trace_sent(size_t len) {
+    put_record(TRACE_SENT, NULL, len);
+}
+
+void trace_output(char type, const char *buf, size_t len) {
+    record_text(type, type == TRACE_STDOUT ? &out_redactor : &err_redactor, buf, len);
+}
+
+// status is sqlplus' exit status, or -1 if we don't know it
+void trace_close(int status) {
+    if(trace == NULL)
+        return;
+    flush_text(TRACE_STDIN, &in_redactor);
+    flush_text(TRACE_STDOUT, &out_redactor);
+    flush_text(TRACE_STDERR, &err_redactor);
+    if(status >= 0)
+        put_record(TRACE_EXIT, NULL, status);
+    if(fclose(trace) != 0) {
+        PERROR("fclose()");
+    }
+    trace=NULL;
+}